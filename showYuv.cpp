@@ -16,9 +16,12 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <getopt.h>
+#include <math.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,6 +33,12 @@
 #include <termios.h>
 #include <unistd.h>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define LOG_TAG "MyShowYUV"
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 //#define LOG_NDEBUG 0
@@ -64,12 +73,24 @@
 
 using namespace android;
 
-static const uint32_t kMinBitRate = 100000;         // 0.1Mbps
-static const uint32_t kMaxBitRate = 200 * 1000000;  // 200Mbps
-static const uint32_t kMaxTimeLimitSec = 180;       // 3 minutes
 static const uint32_t kFallbackWidth = 1280;        // 720p
 static const uint32_t kFallbackHeight = 720;
 static const char* kMimeTypeAvc = "video/avc";
+static const uint32_t kDefaultYuvWidth = 240;
+static const uint32_t kDefaultYuvHeight = 320;
+static const uint32_t kMaxYuvDimension = 8192;      // keeps frame sizes in int
+static const uint32_t kDefaultPeakNits = 1000;      // PQ mastering peak
+static const uint32_t kHlgPeakNits = 1000;          // BT.2100 reference
+static const uint32_t kMaxTeardownMs = 500;         // per soak cycle
+static const size_t kMaxRssGrowthKb = 1024;         // over a whole soak run
+// HAL_PIXEL_FORMAT_YCBCR_P010 and the BT.2020 PQ/HLG data spaces
+// (STANDARD_BT2020 | TRANSFER_ST2084 or TRANSFER_HLG | RANGE_FULL); not
+// present in older system/graphics.h.
+static const int kHalPixelFormatP010 = 0x36;
+static const android_dataspace kHalDataspaceBt2020Pq =
+        (android_dataspace) ((6 << 16) | (7 << 22) | (1 << 27));
+static const android_dataspace kHalDataspaceBt2020Hlg =
+        (android_dataspace) ((6 << 16) | (9 << 22) | (1 << 27));
 
 // Command-line parameters.
 static bool gVerbose = false;           // chatty on stdout
@@ -82,8 +103,29 @@ static bool gWantInfoScreen = false;    // do we want initial info screen?
 static bool gWantFrameTime = false;     // do we want times on each frame?
 static uint32_t gVideoWidth = 0;        // default width+height
 static uint32_t gVideoHeight = 0;
-static uint32_t gBitRate = 4000000;     // 4Mbps
-static uint32_t gTimeLimitSec = kMaxTimeLimitSec;
+static enum {
+    INPUT_YV12, INPUT_P010, INPUT_P016, INPUT_Y410
+} gInputFormat = INPUT_YV12;            // pixel layout of the input file
+static enum {
+    TONEMAP_SHIFT, TONEMAP_PQ, TONEMAP_HLG
+} gToneMap = TONEMAP_SHIFT;             // high-bit-depth to 8-bit reduction
+static bool gWant10BitOutput = false;   // ask for a P010 buffer if possible
+static uint32_t gPeakNits = kDefaultPeakNits;   // PQ mastering peak
+static uint32_t gCycles = 1;            // open/play/close cycles (soak test)
+static uint32_t gFrameRate = 0;         // playback rate; 0 = display rate
+
+// Resolved in prepareRender(): true if the window accepted P010 buffers.
+static bool gUse10BitOutput = false;
+
+// 12-bit code value -> 8.8 fixed-point SDR luma, built by buildToneMapLut().
+static uint16_t gToneMapLut[4096];
+
+// 12-bit code value -> chroma gain (4.12 fixed point) matching the luma
+// highlight compression, also built by buildToneMapLut().
+static uint16_t gChromaScaleLut[4096];
+
+// Per-row scratch for tone-mapping, 4 * width samples.
+static uint16_t *gScratchRow = NULL;
 
 // Set by signal handler to stop recording.
 static volatile bool gStopRequested = false;
@@ -173,7 +215,380 @@ static OMX_U32 GetGrallocFormat(OMX_U32 nFormat) {
 }
 
 
-static void prepareRender(const sp<ANativeWindow> &nativeWindow,int width,int height) {
+/*
+ * Returns "true" if the input is one of the 16-bit-container formats.
+ */
+static bool isHighBitDepthInput() {
+    return gInputFormat != INPUT_YV12;
+}
+
+/*
+ * Returns the size in bytes of one tightly-packed input frame.
+ */
+static size_t getFrameSize(int width, int height) {
+    size_t cw = (width + 1) / 2;
+    size_t ch = (height + 1) / 2;
+
+    switch (gInputFormat) {
+    case INPUT_P010:
+    case INPUT_P016:
+        return width * height * 2 + cw * ch * 4;
+    case INPUT_Y410:
+        return width * height * 4;
+    case INPUT_YV12:
+    default:
+        return width * height + cw * ch * 2;
+    }
+}
+
+/*
+ * Maps one limited-range luma code value, normalized to [0,1], to SDR
+ * display light in [0,1].  HDR output is relative to 203 nits reference
+ * white; light between 0.75 and the source peak is compressed into
+ * [0.75, 1.0] with an extended Reinhard curve, so highlight detail up to
+ * the peak is kept.  The light level before compression is returned in
+ * *pLinear.
+ *
+ * This operates on Y' rather than on linear RGB, which is an
+ * approximation, but it is cheap and good enough for reviewing captures.
+ */
+static double toneMapLuma(double e, double* pLinear) {
+    static const double kRefWhiteNits = 203.0;
+    static const double kKnee = 0.75;
+    double nits;
+    double peakNits;
+
+    if (gToneMap == TONEMAP_PQ) {
+        // SMPTE ST 2084 EOTF.
+        static const double m1 = 2610.0 / 16384.0;
+        static const double m2 = 2523.0 / 4096.0 * 128.0;
+        static const double c1 = 3424.0 / 4096.0;
+        static const double c2 = 2413.0 / 4096.0 * 32.0;
+        static const double c3 = 2392.0 / 4096.0 * 32.0;
+        double p = pow(e, 1.0 / m2);
+        double num = p - c1 > 0.0 ? p - c1 : 0.0;
+        nits = 10000.0 * pow(num / (c2 - c3 * p), 1.0 / m1);
+        peakNits = gPeakNits;
+    } else {
+        // ARIB STD-B67 (HLG) inverse OETF, then the BT.2100 OOTF for a
+        // 1000 nit display (system gamma 1.2).
+        static const double a = 0.17883277;
+        static const double b = 0.28466892;
+        static const double c = 0.55991073;
+        double scene = e <= 0.5 ? e * e / 3.0 : (exp((e - c) / a) + b) / 12.0;
+        nits = kHlgPeakNits * pow(scene, 1.2);
+        peakNits = kHlgPeakNits;
+    }
+
+    double x = nits / kRefWhiteNits;
+    double peak = peakNits / kRefWhiteNits;
+    *pLinear = x;
+    if (x > peak) {
+        x = peak;
+    }
+    if (peak <= 1.0) {
+        // Nothing above reference white to compress.
+        return x > 1.0 ? 1.0 : x;
+    }
+    if (x > kKnee) {
+        // Extended Reinhard on the part above the knee: slope 1 at the
+        // knee, and the source peak lands exactly on 1.0.
+        double t = (x - kKnee) / (1.0 - kKnee);
+        double tPeak = (peak - kKnee) / (1.0 - kKnee);
+        x = kKnee + (1.0 - kKnee) * t * (1.0 + t / (tPeak * tPeak)) / (1.0 + t);
+    }
+    return x;
+}
+
+/*
+ * Fills gToneMapLut for the selected PQ/HLG curve.  Input is a 12-bit
+ * limited-range code value, output is 8-bit limited-range BT.709 luma in
+ * 8.8 fixed point so that the dither stage can round it.
+ */
+static void buildToneMapLut() {
+    for (int code = 0; code < 4096; code++) {
+        double e = (code - 256) / 3504.0;
+        e = e < 0.0 ? 0.0 : (e > 1.0 ? 1.0 : e);
+
+        // BT.1886 inverse EOTF (gamma 2.4) back to a display-referred signal.
+        double linear;
+        double mapped = toneMapLuma(e, &linear);
+        double v = pow(mapped, 1.0 / 2.4);
+        double out = (16.0 + 219.0 * v) * 256.0;
+        gToneMapLut[code] = out > 65535.0 ? 65535 : (uint16_t) out;
+
+        // Scale chroma by the light the highlight knee took away, carried
+        // into the gamma-encoded domain, so highlights don't come out
+        // oversaturated.  Below the knee this is 1.
+        double gain = linear > 0.0 ? pow(mapped / linear, 1.0 / 2.4) : 1.0;
+        gain = gain > 1.0 ? 1.0 : gain;
+        gChromaScaleLut[code] = (uint16_t) (gain * 4096.0 + 0.5);
+    }
+}
+
+static const uint8_t kBayer4x4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+/*
+ * Ordered-dithers a row of MSB-aligned 16-bit samples down to 8 bits.
+ */
+static void ditherRow(const uint16_t* src, uint8_t* dst, int n, int row) {
+    uint16_t d[8];
+    for (int i = 0; i < 8; i++) {
+        d[i] = kBayer4x4[row & 3][i & 3] * 16 + 8;
+    }
+
+    int x = 0;
+#if defined(__ARM_NEON)
+    uint16x8_t vd = vld1q_u16(d);
+    for (; x + 8 <= n; x += 8) {
+        uint16x8_t v = vqaddq_u16(vld1q_u16(src + x), vd);
+        vst1_u8(dst + x, vshrn_n_u16(v, 8));
+    }
+#elif defined(__SSE2__)
+    __m128i vd = _mm_loadu_si128((const __m128i*) d);
+    for (; x + 8 <= n; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (src + x));
+        v = _mm_srli_epi16(_mm_adds_epu16(v, vd), 8);
+        _mm_storel_epi64((__m128i*) (dst + x), _mm_packus_epi16(v, v));
+    }
+#endif
+    for (; x < n; x++) {
+        uint32_t v = src[x] + d[x & 7];
+        dst[x] = (v > 0xffff ? 0xffff : v) >> 8;
+    }
+}
+
+/*
+ * Same as ditherRow(), for n interleaved sample pairs (P010 CbCr), writing
+ * the first of each pair to dstA and the second to dstB.
+ */
+static void ditherRowInterleaved(const uint16_t* src, uint8_t* dstA,
+        uint8_t* dstB, int n, int row) {
+    uint16_t d[8];
+    for (int i = 0; i < 8; i++) {
+        d[i] = kBayer4x4[row & 3][i & 3] * 16 + 8;
+    }
+
+    int x = 0;
+#if defined(__ARM_NEON)
+    uint16x8_t vd = vld1q_u16(d);
+    for (; x + 8 <= n; x += 8) {
+        uint16x8x2_t v = vld2q_u16(src + 2 * x);
+        vst1_u8(dstA + x, vshrn_n_u16(vqaddq_u16(v.val[0], vd), 8));
+        vst1_u8(dstB + x, vshrn_n_u16(vqaddq_u16(v.val[1], vd), 8));
+    }
+#elif defined(__SSE2__)
+    uint16_t d2[8];
+    for (int i = 0; i < 8; i++) {
+        d2[i] = d[(i >> 1) & 3];
+    }
+    __m128i vd = _mm_loadu_si128((const __m128i*) d2);
+    __m128i lowMask = _mm_set1_epi32(0xffff);
+    for (; x + 8 <= n; x += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*) (src + 2 * x));
+        __m128i hi = _mm_loadu_si128((const __m128i*) (src + 2 * x + 8));
+        lo = _mm_srli_epi16(_mm_adds_epu16(lo, vd), 8);
+        hi = _mm_srli_epi16(_mm_adds_epu16(hi, vd), 8);
+        __m128i a = _mm_packs_epi32(_mm_and_si128(lo, lowMask),
+                _mm_and_si128(hi, lowMask));
+        __m128i b = _mm_packs_epi32(_mm_srli_epi32(lo, 16),
+                _mm_srli_epi32(hi, 16));
+        _mm_storel_epi64((__m128i*) (dstA + x), _mm_packus_epi16(a, a));
+        _mm_storel_epi64((__m128i*) (dstB + x), _mm_packus_epi16(b, b));
+    }
+#endif
+    for (; x < n; x++) {
+        uint32_t a = src[2 * x] + d[x & 7];
+        uint32_t b = src[2 * x + 1] + d[x & 7];
+        dstA[x] = (a > 0xffff ? 0xffff : a) >> 8;
+        dstB[x] = (b > 0xffff ? 0xffff : b) >> 8;
+    }
+}
+
+/*
+ * Tone-maps (if requested) and dithers one luma row.
+ */
+static void emitLumaRow(const uint16_t* src, uint8_t* dst, int width, int row) {
+    if (gToneMap != TONEMAP_SHIFT) {
+        uint16_t* mapped = gScratchRow + width * 3;
+        for (int x = 0; x < width; x++) {
+            mapped[x] = gToneMapLut[src[x] >> 4];
+        }
+        src = mapped;
+    }
+    ditherRow(src, dst, width, row);
+}
+
+/*
+ * Applies a 4.12 gain to an MSB-aligned chroma sample around its midpoint.
+ */
+static uint16_t scaleChroma(uint16_t c, int gain) {
+    int v = 32768 + ((int) c - 32768) * gain / 4096;
+    return v < 0 ? 0 : (v > 65535 ? 65535 : v);
+}
+
+/*
+ * Returns the chroma gain for the 2x2 luma block at (x, y) of a plane of
+ * MSB-aligned samples, clamping at the right and bottom edges.
+ */
+static int getBlockChromaGain(const uint16_t* lumaRow0,
+        const uint16_t* lumaRow1, int x, int width) {
+    int x1 = x + 1 < width ? x + 1 : x;
+    uint32_t sum = lumaRow0[x] + lumaRow0[x1] + lumaRow1[x] + lumaRow1[x1];
+    return gChromaScaleLut[sum >> 6];
+}
+
+/*
+ * Converts one high-bit-depth input frame into the YV12 layout of a
+ * locked gralloc buffer.  The PQ/HLG curves are applied to luma, and each
+ * 2x2 block of chroma is scaled down by that block's highlight
+ * compression.  Chroma primaries are not converted, so BT.2020 content
+ * shows slightly desaturated greens and reds.
+ */
+static void toneMapFrame(const void* data, uint8_t* dst, int stride,
+        int bufHeight, int width, int height) {
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    int cStride = ALIGN(stride / 2, 16);
+    uint8_t* dstY = dst;
+    uint8_t* dstV = dst + stride * bufHeight;
+    uint8_t* dstU = dstV + cStride * bufHeight / 2;
+
+    if (gInputFormat == INPUT_Y410) {
+        // Packed 4:4:4, U[9:0] Y[19:10] V[29:20] A[31:30].  Chroma is
+        // subsampled by taking the top-left sample of each 2x2 block.
+        const uint32_t* src = (const uint32_t*) data;
+        uint16_t* rowY = gScratchRow;
+        uint16_t* rowU = gScratchRow + width;
+        uint16_t* rowV = rowU + cw;
+        for (int y = 0; y < height; y++) {
+            const uint32_t* line = src + y * width;
+            for (int x = 0; x < width; x++) {
+                rowY[x] = ((line[x] >> 10) & 0x3ff) << 6;
+            }
+            emitLumaRow(rowY, dstY + y * stride, width, y);
+
+            if ((y & 1) == 0) {
+                for (int x = 0; x < cw; x++) {
+                    rowU[x] = (line[2 * x] & 0x3ff) << 6;
+                    rowV[x] = ((line[2 * x] >> 20) & 0x3ff) << 6;
+                }
+                if (gToneMap != TONEMAP_SHIFT) {
+                    const uint32_t* next = y + 1 < height ? line + width : line;
+                    for (int x = 0; x < cw; x++) {
+                        int x0 = 2 * x;
+                        int x1 = x0 + 1 < width ? x0 + 1 : x0;
+                        uint32_t sum = ((line[x0] >> 10) & 0x3ff)
+                                + ((line[x1] >> 10) & 0x3ff)
+                                + ((next[x0] >> 10) & 0x3ff)
+                                + ((next[x1] >> 10) & 0x3ff);
+                        // Four 10-bit samples sum to 12 bits.
+                        int gain = gChromaScaleLut[sum];
+                        rowU[x] = scaleChroma(rowU[x], gain);
+                        rowV[x] = scaleChroma(rowV[x], gain);
+                    }
+                }
+                ditherRow(rowU, dstU + (y / 2) * cStride, cw, y / 2);
+                ditherRow(rowV, dstV + (y / 2) * cStride, cw, y / 2);
+            }
+        }
+        return;
+    }
+
+    // P010 / P016: MSB-aligned 16-bit Y plane, then interleaved CbCr.
+    const uint16_t* srcY = (const uint16_t*) data;
+    const uint16_t* srcC = srcY + width * height;
+    for (int y = 0; y < height; y++) {
+        emitLumaRow(srcY + y * width, dstY + y * stride, width, y);
+    }
+    for (int y = 0; y < ch; y++) {
+        const uint16_t* rowC = srcC + y * cw * 2;
+        if (gToneMap != TONEMAP_SHIFT) {
+            const uint16_t* luma0 = srcY + 2 * y * width;
+            const uint16_t* luma1 = 2 * y + 1 < height ? luma0 + width : luma0;
+            uint16_t* scaled = gScratchRow;
+            for (int x = 0; x < cw; x++) {
+                int gain = getBlockChromaGain(luma0, luma1, 2 * x, width);
+                scaled[2 * x] = scaleChroma(rowC[2 * x], gain);
+                scaled[2 * x + 1] = scaleChroma(rowC[2 * x + 1], gain);
+            }
+            rowC = scaled;
+        }
+        ditherRowInterleaved(rowC, dstU + y * cStride, dstV + y * cStride,
+                cw, y);
+    }
+}
+
+/*
+ * Copies a tightly-packed YV12 input frame into the YV12 layout of a
+ * locked gralloc buffer, one row at a time so the buffer stride is
+ * honoured.
+ */
+static void copyYV12Frame(const void* data, uint8_t* dst, int stride,
+        int bufHeight, int width, int height) {
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    int cStride = ALIGN(stride / 2, 16);//1行v/u的大小
+    const uint8_t* srcY = (const uint8_t*) data;
+    const uint8_t* srcV = srcY + width * height;
+    const uint8_t* srcU = srcV + cw * ch;
+    uint8_t* dstV = dst + stride * bufHeight;
+    uint8_t* dstU = dstV + cStride * bufHeight / 2;
+
+    for (int y = 0; y < height; y++) {
+        memcpy(dst + y * stride, srcY + y * width, width);
+    }
+    for (int y = 0; y < ch; y++) {
+        memcpy(dstV + y * cStride, srcV + y * cw, cw);
+        memcpy(dstU + y * cStride, srcU + y * cw, cw);
+    }
+}
+
+/*
+ * Copies a P010/P016 input frame into a locked P010 gralloc buffer.
+ */
+static void copyP010Frame(const void* data, const android_ycbcr* ycbcr,
+        int width, int height) {
+    int cw = (width + 1) / 2;
+    int ch = (height + 1) / 2;
+    const uint8_t* srcY = (const uint8_t*) data;
+    const uint8_t* srcC = srcY + width * height * 2;
+
+    for (int y = 0; y < height; y++) {
+        memcpy((uint8_t*) ycbcr->y + y * ycbcr->ystride,
+                srcY + y * width * 2, width * 2);
+    }
+    // For P010 cb points at the interleaved CbCr plane.
+    for (int y = 0; y < ch; y++) {
+        memcpy((uint8_t*) ycbcr->cb + y * ycbcr->cstride,
+                srcC + y * cw * 4, cw * 4);
+    }
+}
+
+
+/*
+ * Checks that a dequeued P010 buffer can be locked for CPU writes with the
+ * interleaved CbCr layout copyP010Frame() expects.
+ */
+static status_t probeP010Lock(ANativeWindowBuffer* buf, int width, int height) {
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    android_ycbcr ycbcr;
+    status_t err = mapper.lockYCbCr(buf->handle, GRALLOC_USAGE_SW_WRITE_OFTEN,
+            Rect(width, height), &ycbcr);
+    if (err != OK) {
+        return err;
+    }
+    bool interleaved = ycbcr.chroma_step == 4;
+    mapper.unlock(buf->handle);
+    return interleaved ? OK : INVALID_OPERATION;
+}
+
+static status_t prepareRender(const sp<ANativeWindow> &nativeWindow,int width,int height) {
 			
     sp<ANativeWindow> m_pNativeWindow = nativeWindow;
     //int err;
@@ -187,13 +602,18 @@ static void prepareRender(const sp<ANativeWindow> &nativeWindow,int width,int he
 	int m_nFrameWidth = width;
 	int m_nFrameHeight = height;
 	
-	native_window_api_connect(m_pNativeWindow.get(), NATIVE_WINDOW_API_MEDIA);
+	status_t err = native_window_api_connect(m_pNativeWindow.get(),
+            NATIVE_WINDOW_API_MEDIA);
+    if (err != OK) {
+        printf("native_window_api_connect failed: %d\n", err);
+        return err;
+    }
 	
-	status_t err = native_window_set_scaling_mode(
+	err = native_window_set_scaling_mode(
             m_pNativeWindow.get(), NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW);
     if (err != OK) {
         printf("native_window_set_scaling_mode failed");
-        return;
+        return err;
     }
 	
 	android_native_rect_t crop;
@@ -207,17 +627,18 @@ static void prepareRender(const sp<ANativeWindow> &nativeWindow,int width,int he
     err = native_window_set_crop(m_pNativeWindow.get(), &crop);
     if (err != OK) {
         printf("native_window_set_crop failed");
-        return;
+        return err;
     }
 
+    // YV12 needs even dimensions; the crop above hides the padding.
     printf("nativeWindow set geometry: w=%u h=%u",
-            (unsigned int)m_nFrameWidth, (unsigned int)m_nFrameHeight);
+            (unsigned int)bufWidth, (unsigned int)bufHeight);
 			
     err = native_window_set_buffers_geometry(m_pNativeWindow.get(),
-            m_nFrameWidth, m_nFrameHeight, GetGrallocFormat(m_nColorFormat));
+            bufWidth, bufHeight, GetGrallocFormat(m_nColorFormat));
     if (err != OK) {
         printf("native_window_set_buffers_geometry failed");
-        return;
+        return err;
     }
 	
 	err = native_window_set_usage(m_pNativeWindow.get(), GRALLOC_USAGE_SW_READ_NEVER | GRALLOC_USAGE_SW_WRITE_OFTEN |
@@ -225,16 +646,56 @@ static void prepareRender(const sp<ANativeWindow> &nativeWindow,int width,int he
     if (err != 0) {
         printf("native_window_set_usage failed: %s (%d)",
                 strerror(-err), -err);
-        return;
+        return err;
     }
 	
+    gUse10BitOutput = false;
+    if (gWant10BitOutput) {
+        // main() only allows this for p010/p016 input.  There's no way to
+        // query the sink, so try to get a P010 buffer tagged with the
+        // input's transfer function, and fall back to tone-mapping into
+        // YV12 if any step fails.
+        android_dataspace dataSpace = gToneMap == TONEMAP_HLG ?
+                kHalDataspaceBt2020Hlg : kHalDataspaceBt2020Pq;
+        ANativeWindowBuffer* probe;
+        err = native_window_set_buffers_geometry(m_pNativeWindow.get(),
+                bufWidth, bufHeight, kHalPixelFormatP010);
+        if (err == OK) {
+            err = native_window_set_buffers_data_space(
+                    m_pNativeWindow.get(), dataSpace);
+        }
+        if (err == OK) {
+            err = native_window_dequeue_buffer_and_wait(
+                    m_pNativeWindow.get(), &probe);
+            if (err == OK) {
+                // Some grallocs can allocate P010 but not map it for
+                // CPU writes; render() relies on both.
+                err = probeP010Lock(probe, m_nFrameWidth, m_nFrameHeight);
+                m_pNativeWindow->cancelBuffer(m_pNativeWindow.get(),
+                        probe, -1);
+            }
+        }
+        if (err == OK) {
+            gUse10BitOutput = true;
+        } else {
+            printf("P010 buffers not supported (%d), tone-mapping to 8-bit\n",
+                    err);
+            native_window_set_buffers_data_space(m_pNativeWindow.get(),
+                    HAL_DATASPACE_UNKNOWN);
+            native_window_set_buffers_geometry(m_pNativeWindow.get(),
+                    bufWidth, bufHeight,
+                    GetGrallocFormat(m_nColorFormat));
+        }
+    }
+
 	printf("Surface  render start \n");	
 	
+    return NO_ERROR;
 }
 
 
 
-static void render(const void *data, size_t size, const sp<ANativeWindow> &nativeWindow,int width,int height) {
+static status_t render(const void *data, size_t size, const sp<ANativeWindow> &nativeWindow,int width,int height) {
 			
     sp<ANativeWindow> m_pNativeWindow = nativeWindow;
     int err;
@@ -299,11 +760,14 @@ static void render(const void *data, size_t size, const sp<ANativeWindow> &nativ
 	
     err = native_window_dequeue_buffer_and_wait(m_pNativeWindow.get(), &winbuf);
     if(err != 0) {
-        printf("dequeueBuffer failed: %s (%d)",strerror(-err), -err);
-        return; //TBD: cancel allocated ones
+        printf("dequeueBuffer failed: %s (%d)\n",strerror(-err), -err);
+        winbuf = NULL;
+        return err;
     }
 	
-	printf("Surface  get native window sucess");
+    if (gVerbose) {
+        printf("Surface  get native window sucess\n");
+    }
  
     GraphicBufferMapper &mapper = GraphicBufferMapper::get();
  
@@ -311,33 +775,42 @@ static void render(const void *data, size_t size, const sp<ANativeWindow> &nativ
  
     void *dst;
 	
-    CHECK_EQ(0, mapper.lock(//用来锁定一个图形缓冲区并将缓冲区映射到用户进程
+    if (gUse10BitOutput) {
+        android_ycbcr ycbcr;
+        CHECK_EQ(0, mapper.lockYCbCr(
+                winbuf->handle, GRALLOC_USAGE_SW_WRITE_OFTEN, bounds, &ycbcr));
+        copyP010Frame(data, &ycbcr, mCropWidth, mCropHeight);
+    } else {
+        CHECK_EQ(0, mapper.lock(//用来锁定一个图形缓冲区并将缓冲区映射到用户进程
                 winbuf->handle, GRALLOC_USAGE_SW_WRITE_OFTEN, bounds, &dst));//dst就指向图形缓冲区首地址
- 
-    if (true){
-        size_t dst_y_size = winbuf->stride * winbuf->height;
-        size_t dst_c_stride = ALIGN(winbuf->stride / 2, 16);//1行v/u的大小
-        size_t dst_c_size = dst_c_stride * winbuf->height / 2;//u/v的大小
-        
-        memcpy(dst, data, dst_y_size + dst_c_size*2);//将yuv数据copy到图形缓冲区
+
+        if (isHighBitDepthInput()) {
+            toneMapFrame(data, (uint8_t*) dst, winbuf->stride, winbuf->height,
+                    mCropWidth, mCropHeight);
+        } else {
+            copyYV12Frame(data, (uint8_t*) dst, winbuf->stride, winbuf->height,
+                    mCropWidth, mCropHeight);//将yuv数据copy到图形缓冲区
+        }
     }
  
     CHECK_EQ(0, mapper.unlock(winbuf->handle));
-	
-	sleep(1);
  
     if ((err = m_pNativeWindow->queueBuffer(m_pNativeWindow.get(), winbuf,
             -1)) != 0) {
-        printf("Surface::queueBuffer returned error %d", err);
+        printf("Surface::queueBuffer returned error %d\n", err);
+        // The queue rejected it, so the buffer is still ours to return.
+        m_pNativeWindow->cancelBuffer(m_pNativeWindow.get(), winbuf, -1);
+        winbuf = NULL;
+        return err;
     }
 	
-	printf("Surface::queueBuffer over");
-	
-	
-	
-	
-	
-    //winbuf = NULL;
+    if (gVerbose) {
+        printf("Surface::queueBuffer over\n");
+    }
+
+    // Once queued the buffer belongs to the consumer.
+    winbuf = NULL;
+    return NO_ERROR;
 }
 
 static bool getYV12Data(const char *path,unsigned char * pYUVData,int size){
@@ -352,87 +825,112 @@ static bool getYV12Data(const char *path,unsigned char * pYUVData,int size){
 }
 
 
-static void destroySurface(const sp<ANativeWindow> &nativeWindow,sp<Surface> &surface,sp<SurfaceControl> &Control,sp<SurfaceControl> &BackgroundControl) {
-
-	sp<ANativeWindow> m_pNativeWindow = nativeWindow;
-	sp<Surface> m_pSurface = surface;
-	sp<SurfaceControl> m_pControl = Control;
-	sp<SurfaceControl> m_pBackgroundControl = BackgroundControl;
-	
-    if (m_pNativeWindow.get() != NULL) {
-        native_window_api_disconnect(m_pNativeWindow.get(), NATIVE_WINDOW_API_MEDIA);
-        m_pNativeWindow.clear();
-        m_pNativeWindow = NULL;
-    }
+/*
+ * Disconnects from the window and drops our references to the surface and
+ * its layers.  Any buffer we still hold is returned first.
+ */
+static void destroySurface(sp<Surface> &surface,sp<SurfaceControl> &Control,sp<SurfaceControl> &BackgroundControl) {
 
-    if (m_pSurface.get() != NULL) {
-        m_pSurface.clear();
-        m_pSurface = NULL;
+    if (surface.get() != NULL) {
+        ANativeWindow* nativeWindow = surface.get();
+        if (winbuf != NULL) {
+            nativeWindow->cancelBuffer(nativeWindow, winbuf, -1);
+            winbuf = NULL;
+        }
+        native_window_api_disconnect(nativeWindow, NATIVE_WINDOW_API_MEDIA);
+        surface.clear();
     }
 
-    if (m_pControl.get() != NULL) {
-        m_pControl.clear();
-        m_pControl = NULL;
+    if (Control.get() != NULL) {
+        Control.clear();
     }
 
-    if (m_pBackgroundControl.get() != NULL) {
-        m_pBackgroundControl.clear();
-        m_pBackgroundControl = NULL;
+    if (BackgroundControl.get() != NULL) {
+        BackgroundControl.clear();
     }
     
-    printf("I'm getting free!!");
+    printf("I'm getting free!!\n");
 }
 
+/*
+ * Reads the resident set size of this process, in KB, and the number of
+ * file descriptors it has open.  Leaked gralloc buffers and fences show up
+ * as fds rather than as resident memory, so the soak test checks both.
+ */
+static status_t getProcessStats(size_t* pResidentKb, int* pFdCount) {
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        status_t err = -errno;
+        fprintf(stderr, "Unable to open /proc/self/statm: %s\n",
+                strerror(-err));
+        return err;
+    }
+    unsigned long totalPages, residentPages;
+    int count = fscanf(fp, "%lu %lu", &totalPages, &residentPages);
+    fclose(fp);
+    if (count != 2) {
+        fprintf(stderr, "Unable to parse /proc/self/statm\n");
+        return UNKNOWN_ERROR;
+    }
+    *pResidentKb = residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir == NULL) {
+        status_t err = -errno;
+        fprintf(stderr, "Unable to open /proc/self/fd: %s\n",
+                strerror(-err));
+        return err;
+    }
+    int fds = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            fds++;
+        }
+    }
+    closedir(dir);
+    // Don't count the descriptor opendir() used.
+    *pFdCount = fds - 1;
+    return NO_ERROR;
+}
 
 /*
- * Main "do work" start point.
+ * Opens a surface, plays the file through it once, and tears everything
+ * down again.  Playback stops early if a stop is requested.
  *
- * Configures codec, muxer, and virtual display, then starts moving bits
- * around.
+ * If holdLastFrame is set, the last frame stays on screen until a stop is
+ * requested.  The time spent tearing down is returned in *pTeardownTime.
  */
-static status_t showYUV(const char* fileName) {
-    status_t err;
+static status_t playYUV(const sp<SurfaceComposerClient>& client,
+        const DisplayInfo& mainDpyInfo, const char* fileName,
+        bool holdLastFrame, nsecs_t* pTeardownTime) {
+    status_t err = NO_ERROR;
 
-    // Configure signal handler.
-    err = configureSignals();
-    if (err != NO_ERROR) return err;
+	int width,height;
+	width = gSizeSpecified ? gVideoWidth : kDefaultYuvWidth;
+	height = gSizeSpecified ? gVideoHeight : kDefaultYuvHeight;
+	int size = getFrameSize(width, height);
 
-    // Start Binder thread pool.  MediaCodec needs to be able to receive
-    // messages from mediaserver.
-    sp<ProcessState> self = ProcessState::self();
-    self->startThreadPool();
-	
-	sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+	FILE *fp = fopen(fileName,"rb");
+	if(fp == NULL){
+        status_t openErr = -errno;
+		printf("read %s fail !!!!!!!!!!!!!!!!!!!\n",fileName);
+		return openErr;
+	}
 
-    // Get main display parameters.
-    sp<IBinder> mainDpy = SurfaceComposerClient::getBuiltInDisplay(
-            ISurfaceComposer::eDisplayIdMain);
-			
-    DisplayInfo mainDpyInfo;
-    err = SurfaceComposerClient::getDisplayInfo(mainDpy, &mainDpyInfo);
-    if (err != NO_ERROR) {
-        fprintf(stderr, "ERROR: unable to get display characteristics\n");
-        return err;
-    }
-	
-    if (true) {
-        printf("Main display is %dx%d @%.2ffps (orientation=%u)\n",
-                mainDpyInfo.w, mainDpyInfo.h, mainDpyInfo.fps,
-                mainDpyInfo.orientation);
-    }
-			
 	sp<SurfaceControl> m_pBackgroundControl = client->createSurface(String8("vdec-bkgnd"), mainDpyInfo.w,mainDpyInfo.h, PIXEL_FORMAT_RGB_565);
 
     sp<SurfaceControl> m_pControl = client->createSurface(String8("vdec-surface"), mainDpyInfo.w,mainDpyInfo.h, PIXEL_FORMAT_OPAQUE);
+    if (m_pBackgroundControl == NULL || m_pControl == NULL) {
+        fprintf(stderr, "ERROR: unable to create surfaces\n");
+        fclose(fp);
+        return UNKNOWN_ERROR;
+    }
 	
-	int width,height;
-	width = 240;
-	height = 320;
-	int size = width * height * 3/2;
 	unsigned char *data = new unsigned char[size];
-	
-	//getYV12Data(fileName,data,size);//get yuv data from file;
-
+    if (isHighBitDepthInput()) {
+        gScratchRow = new uint16_t[width * 4];
+    }
 
     /*********************配置surface*******************************************************************/
     SurfaceComposerClient::openGlobalTransaction();
@@ -454,41 +952,168 @@ static status_t showYUV(const char* fileName) {
 	sp<Surface> surface = m_pControl->getSurface();
 	printf("[%s][%d]\n",__FILE__,__LINE__);
 	
-	
-	
 /**********************显示yuv数据******************************************************************/	
 
-	prepareRender(surface,width,height);
-	
-	FILE *fp = fopen(fileName,"rb");
-	if(fp == NULL){
-		printf("read %s fail !!!!!!!!!!!!!!!!!!!\n",fileName);
-		return false;
-	}
-	while(!feof(fp)){
-		int num  = fread(data,1,size,fp);
-		printf("read data [%d]\n",num);
-		render(data,size,surface,width,height);
-	}
+	err = prepareRender(surface,width,height);
+
+    // Pace frames from --fps, or from the display refresh rate.
+    double fps = gFrameRate != 0 ? gFrameRate : mainDpyInfo.fps;
+    nsecs_t frameInterval =
+            fps > 0 ? (nsecs_t) (seconds_to_nanoseconds(1) / fps) : 0;
+    nsecs_t nextFrameTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    int frames = 0;
+    while (err == NO_ERROR && !gStopRequested) {
+        size_t num = fread(data, 1, size, fp);
+        if (num < (size_t) size) {
+            // EOF, or a truncated last frame we can't show.
+            break;
+        }
+
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (now < nextFrameTime) {
+            usleep((nextFrameTime - now) / 1000);
+        } else {
+            // Running late; don't try to catch up with a burst of frames.
+            nextFrameTime = now;
+        }
+        nextFrameTime += frameInterval;
+
+        err = render(data,size,surface,width,height);
+        if (err == NO_ERROR) {
+            frames++;
+        }
+    }
 	fclose(fp);
+    if (gVerbose) {
+        printf("Rendered %d frames%s\n", frames,
+                gStopRequested ? " (stopped)" : "");
+    }
+
+    if (holdLastFrame && err == NO_ERROR) {
+        // Keep the last frame on screen until Ctrl-C.
+        while (!gStopRequested) {
+            usleep(100000);
+        }
+    }
+
+    nsecs_t teardownStart = systemTime(SYSTEM_TIME_MONOTONIC);
+
+	destroySurface(surface,m_pControl,m_pBackgroundControl);
+
+    // Make sure the layers are really gone before we report back.
+    SurfaceComposerClient::openGlobalTransaction();
+    SurfaceComposerClient::closeGlobalTransaction(true);
+
+    delete[] data;
+    delete[] gScratchRow;
+    gScratchRow = NULL;
+
+    *pTeardownTime = systemTime(SYSTEM_TIME_MONOTONIC) - teardownStart;
 	
-	sp<ANativeWindow> m_pNativeWindow = surface;
+	printf("[%s][%d]\n",__FILE__,__LINE__);
+
+    return err;
+}
+
+/*
+ * Main "do work" start point.
+ *
+ * Connects to SurfaceFlinger, then plays the file once (holding the last
+ * frame until Ctrl-C), or gCycles times back to back as a soak test.  In
+ * soak mode, resident memory and open fds must stay flat and each teardown
+ * must finish within kMaxTeardownMs.
+ */
+static status_t showYUV(const char* fileName) {
+    status_t err;
+
+    // Configure signal handler.
+    err = configureSignals();
+    if (err != NO_ERROR) return err;
+
+    // Start Binder thread pool.  MediaCodec needs to be able to receive
+    // messages from mediaserver.
+    sp<ProcessState> self = ProcessState::self();
+    self->startThreadPool();
 	
-	err = m_pNativeWindow->cancelBuffer(m_pNativeWindow.get(), winbuf, -1);
-    if (err != 0) {
-        printf("cancelBuffer failed w/ error 0x%08x", err);
+	sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+
+    // Get main display parameters.
+    sp<IBinder> mainDpy = SurfaceComposerClient::getBuiltInDisplay(
+            ISurfaceComposer::eDisplayIdMain);
+			
+    DisplayInfo mainDpyInfo;
+    err = SurfaceComposerClient::getDisplayInfo(mainDpy, &mainDpyInfo);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "ERROR: unable to get display characteristics\n");
+        client->dispose();
         return err;
     }
 	
-	destroySurface(surface,surface,m_pControl,m_pBackgroundControl);
-	
-	printf("[%s][%d]\n",__FILE__,__LINE__);
+    if (true) {
+        printf("Main display is %dx%d @%.2ffps (orientation=%u)\n",
+                mainDpyInfo.w, mainDpyInfo.h, mainDpyInfo.fps,
+                mainDpyInfo.orientation);
+    }
+
+    if (isHighBitDepthInput() && gToneMap != TONEMAP_SHIFT) {
+        buildToneMapLut();
+    }
+
+    bool soak = gCycles > 1;
+    size_t baselineKb = 0;
+    size_t finalKb = 0;
+    int baselineFds = 0;
+    int finalFds = 0;
+    nsecs_t maxTeardown = 0;
+    uint32_t cycle;
+    for (cycle = 0; cycle < gCycles && !gStopRequested; cycle++) {
+        nsecs_t teardownTime = 0;
+        err = playYUV(client, mainDpyInfo, fileName, !soak, &teardownTime);
+        if (err != NO_ERROR || !soak) {
+            break;
+        }
+
+        if (teardownTime > maxTeardown) {
+            maxTeardown = teardownTime;
+        }
+        err = getProcessStats(&finalKb, &finalFds);
+        if (err != NO_ERROR) {
+            break;
+        }
+        if (cycle == 0) {
+            // First cycle warms up gralloc and binder; measure from here.
+            baselineKb = finalKb;
+            baselineFds = finalFds;
+        }
+        if (gVerbose) {
+            printf("cycle %u: teardown %.3fms, rss %zuKB, %d fds\n", cycle + 1,
+                    teardownTime / 1000000.0, finalKb, finalFds);
+        }
+    }
 	
 	client->dispose();
-	
-	IPCThreadState::self()->joinThreadPool();//可以保证画面一直显示，否则瞬间消失
     IPCThreadState::self()->stopProcess();
-    
+
+    if (soak && err == NO_ERROR) {
+        printf("Soak: %u cycles, max teardown %.3fms, rss %zuKB -> %zuKB, "
+                "fds %d -> %d\n", cycle, maxTeardown / 1000000.0,
+                baselineKb, finalKb, baselineFds, finalFds);
+        if (maxTeardown > milliseconds_to_nanoseconds(kMaxTeardownMs)) {
+            fprintf(stderr, "ERROR: teardown exceeded %ums\n", kMaxTeardownMs);
+            err = TIMED_OUT;
+        }
+        if (finalKb > baselineKb + kMaxRssGrowthKb) {
+            fprintf(stderr, "ERROR: resident memory grew by %zuKB\n",
+                    finalKb - baselineKb);
+            err = NO_MEMORY;
+        }
+        if (finalFds > baselineFds) {
+            fprintf(stderr, "ERROR: leaked %d file descriptors\n",
+                    finalFds - baselineFds);
+            err = NO_MEMORY;
+        }
+    }
 
     return err;
 }
@@ -580,6 +1205,12 @@ static bool parseWidthHeight(const char* widthHeight, uint32_t* pWidth,
         // invalid chars in height
         return false;
     }
+    if (width < 0 || height < 0 ||
+            (unsigned long) width > UINT32_MAX ||
+            (unsigned long) height > UINT32_MAX) {
+        // negative, or would wrap when stored
+        return false;
+    }
 
     *pWidth = width;
     *pHeight = height;
@@ -587,27 +1218,25 @@ static bool parseWidthHeight(const char* widthHeight, uint32_t* pWidth,
 }
 
 /*
- * Accepts a string with a bare number ("4000000") or with a single-character
- * unit ("4m").
+ * Parses a plain positive decimal integer, e.g. "30".
  *
- * Returns an error if parsing fails.
+ * Returns true on success.
  */
-static status_t parseValueWithUnit(const char* str, uint32_t* pValue) {
-    long value;
-    char* endptr;
-
-    value = strtol(str, &endptr, 10);
-    if (*endptr == '\0') {
-        // bare number
-        *pValue = value;
-        return NO_ERROR;
-    } else if (toupper(*endptr) == 'M' && *(endptr+1) == '\0') {
-        *pValue = value * 1000000;  // check for overflow?
-        return NO_ERROR;
-    } else {
-        fprintf(stderr, "Unrecognized value: %s\n", str);
-        return UNKNOWN_ERROR;
+static bool parsePositiveInteger(const char* str, uint32_t* pValue) {
+    char* end;
+
+    if (!isdigit(*str)) {
+        // rejects empty strings, signs and leading whitespace
+        return false;
     }
+    errno = 0;
+    unsigned long value = strtoul(str, &end, 10);
+    if (*end != '\0' || errno != 0 || value == 0 || value > UINT32_MAX) {
+        return false;
+    }
+
+    *pValue = value;
+    return true;
 }
 
 /*
@@ -615,31 +1244,43 @@ static status_t parseValueWithUnit(const char* str, uint32_t* pValue) {
  */
 static void usage() {
     fprintf(stderr,
-        "Usage: screenrecord [options] <filename>\n"
+        "Usage: myshowyuv [options] <filename>\n"
         "\n"
-        "Android screenrecord v%d.%d.  Records the device's display to a .mp4 file.\n"
+        "myshowyuv v%d.%d.  Shows a raw YUV file on the device's display.\n"
         "\n"
         "Options:\n"
         "--size WIDTHxHEIGHT\n"
-        "    Set the video size, e.g. \"1280x720\".  Default is the device's main\n"
-        "    display resolution (if supported), 1280x720 if not.  For best results,\n"
-        "    use a size supported by the AVC encoder.\n"
-        "--bit-rate RATE\n"
-        "    Set the video bit rate, in bits per second.  Value may be specified as\n"
-        "    bits or megabits, e.g. '4000000' is equivalent to '4M'.  Default %dMbps.\n"
-        "--bugreport\n"
-        "    Add additional information, such as a timestamp overlay, that is helpful\n"
-        "    in videos captured to illustrate bugs.\n"
-        "--time-limit TIME\n"
-        "    Set the maximum recording time, in seconds.  Default / maximum is %d.\n"
+        "    Set the frame size of the input file, e.g. \"1280x720\".  Default is\n"
+        "    %ux%u.\n"
+        "--input-format FORMAT\n"
+        "    Pixel layout of the input file: yv12 (default), p010, p016 or y410.\n"
+        "--tone-map MODE\n"
+        "    How high-bit-depth input is reduced to 8 bits: shift (default), pq\n"
+        "    or hlg.\n"
+        "--peak-nits NITS\n"
+        "    Peak luminance of PQ input, in nits.  Highlights up to this level\n"
+        "    are compressed rather than clipped.  Default %u.\n"
+        "--10bit\n"
+        "    Display p010/p016 input in a 10-bit P010 buffer tagged as BT.2020 PQ\n"
+        "    or HLG (from --tone-map) if the display supports it.  Falls back to\n"
+        "    tone-mapping otherwise.\n"
+        "--fps RATE\n"
+        "    Play back at RATE frames per second.  Default is the display's\n"
+        "    refresh rate.\n"
+        "--cycles COUNT\n"
+        "    Open, play and close the file COUNT times back to back, then fail if\n"
+        "    resident memory or open fds grew or any teardown took longer than\n"
+        "    %ums.\n"
         "--verbose\n"
         "    Display interesting information on stdout.\n"
         "--help\n"
         "    Show this message.\n"
         "\n"
-        "Recording continues until Ctrl-C is hit or the time limit is reached.\n"
+        "Playback stops at the end of the file or when Ctrl-C is hit.  Without\n"
+        "--cycles, the last frame stays on screen until Ctrl-C.\n"
         "\n",
-        kVersionMajor, kVersionMinor, gBitRate / 1000000, gTimeLimitSec
+        kVersionMajor, kVersionMinor, kDefaultYuvWidth, kDefaultYuvHeight,
+        kDefaultPeakNits, kMaxTeardownMs
         );
 }
 
@@ -651,20 +1292,133 @@ int main(int argc, char* const argv[]) {
         { "help",               no_argument,        NULL, 'h' },
         { "verbose",            no_argument,        NULL, 'v' },
         { "size",               required_argument,  NULL, 's' },
-        { "bit-rate",           required_argument,  NULL, 'b' },
-        { "time-limit",         required_argument,  NULL, 't' },
-        { "bugreport",          no_argument,        NULL, 'u' },
-        // "unofficial" options
-        { "show-device-info",   no_argument,        NULL, 'i' },
-        { "show-frame-time",    no_argument,        NULL, 'f' },
-        { "rotate",             no_argument,        NULL, 'r' },
-        { "output-format",      required_argument,  NULL, 'o' },
+        { "input-format",       required_argument,  NULL, 'I' },
+        { "tone-map",           required_argument,  NULL, 'T' },
+        { "10bit",              no_argument,        NULL, 'X' },
+        { "cycles",             required_argument,  NULL, 'C' },
+        { "fps",                required_argument,  NULL, 'F' },
+        { "peak-nits",          required_argument,  NULL, 'P' },
         { NULL,                 0,                  NULL, 0 }
     };
+
+    bool peakSpecified = false;
+    while (true) {
+        int optionIndex = 0;
+        int ic = getopt_long(argc, argv, "", longOptions, &optionIndex);
+        if (ic == -1) {
+            break;
+        }
+
+        switch (ic) {
+        case 'h':
+            usage();
+            return 0;
+        case 'v':
+            gVerbose = true;
+            break;
+        case 's':
+            if (!parseWidthHeight(optarg, &gVideoWidth, &gVideoHeight)) {
+                fprintf(stderr, "Invalid size '%s', must be width x height\n",
+                        optarg);
+                return 2;
+            }
+            if (gVideoWidth == 0 || gVideoHeight == 0 ||
+                    gVideoWidth > kMaxYuvDimension ||
+                    gVideoHeight > kMaxYuvDimension) {
+                fprintf(stderr,
+                    "Invalid size %ux%u, width and height must be 1-%u\n",
+                    gVideoWidth, gVideoHeight, kMaxYuvDimension);
+                return 2;
+            }
+            gSizeSpecified = true;
+            break;
+        case 'I':
+            if (strcmp(optarg, "yv12") == 0) {
+                gInputFormat = INPUT_YV12;
+            } else if (strcmp(optarg, "p010") == 0) {
+                gInputFormat = INPUT_P010;
+            } else if (strcmp(optarg, "p016") == 0) {
+                gInputFormat = INPUT_P016;
+            } else if (strcmp(optarg, "y410") == 0) {
+                gInputFormat = INPUT_Y410;
+            } else {
+                fprintf(stderr, "Unknown input format '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'T':
+            if (strcmp(optarg, "shift") == 0) {
+                gToneMap = TONEMAP_SHIFT;
+            } else if (strcmp(optarg, "pq") == 0) {
+                gToneMap = TONEMAP_PQ;
+            } else if (strcmp(optarg, "hlg") == 0) {
+                gToneMap = TONEMAP_HLG;
+            } else {
+                fprintf(stderr, "Unknown tone-map mode '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'X':
+            gWant10BitOutput = true;
+            break;
+        case 'P':
+            if (!parsePositiveInteger(optarg, &gPeakNits) ||
+                    gPeakNits > 10000) {
+                fprintf(stderr, "Invalid peak luminance '%s'\n", optarg);
+                return 2;
+            }
+            peakSpecified = true;
+            break;
+        case 'F':
+            if (!parsePositiveInteger(optarg, &gFrameRate)) {
+                fprintf(stderr, "Invalid frame rate '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        case 'C':
+            if (!parsePositiveInteger(optarg, &gCycles)) {
+                fprintf(stderr, "Invalid cycle count '%s'\n", optarg);
+                return 2;
+            }
+            break;
+        default:
+            if (ic != '?') {
+                fprintf(stderr, "getopt_long returned unexpected value 0x%x\n", ic);
+            }
+            usage();
+            return 2;
+        }
+    }
 	
+    if (gToneMap != TONEMAP_SHIFT && !isHighBitDepthInput()) {
+        fprintf(stderr, "--tone-map %s requires p010, p016 or y410 input\n",
+                gToneMap == TONEMAP_PQ ? "pq" : "hlg");
+        return 2;
+    }
+    if (peakSpecified && gToneMap != TONEMAP_PQ) {
+        // HLG is scene-referred and always assumes a 1000 nit display.
+        fprintf(stderr, "--peak-nits only applies to --tone-map pq\n");
+        return 2;
+    }
+    if (gWant10BitOutput && gInputFormat != INPUT_P010 &&
+            gInputFormat != INPUT_P016) {
+        fprintf(stderr, "--10bit requires p010 or p016 input\n");
+        return 2;
+    }
+    if (gWant10BitOutput && gToneMap == TONEMAP_SHIFT) {
+        // The P010 buffer has to be tagged as PQ or HLG for the compositor.
+        fprintf(stderr, "--10bit requires --tone-map pq or hlg\n");
+        return 2;
+    }
+
+    if (optind != argc - 1) {
+        fprintf(stderr, "Must specify input file name.\n");
+        return 2;
+    }
+
 	fprintf(stderr, "argc=%d,optind=%d,file name=%s.\n",argc,optind,argv[argc-1]);
 
-    const char* fileName = argv[argc - 1];
+    const char* fileName = argv[optind];
 	
     //if (gOutputFormat == FORMAT_MP4) {
         // MediaMuxer tries to create the file in the constructor, but we don't